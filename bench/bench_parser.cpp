@@ -0,0 +1,116 @@
+// Parser benchmark
+// ===========================
+//
+// Times parse_text over synthetic notes, no files involved.
+//
+// usage: morg_bench [number of notes]
+
+#include <morg/morg.h>
+
+using namespace morg;
+using bench_clock = std::chrono::steady_clock;
+
+std::vector<std::string> yaml_note()
+{
+    return {
+      "---",
+      "title: Hello World",
+      "date: 2021-01-31 18:44:26",
+      "aliases:",
+      "  - hw",
+      "tags:",
+      "    - HelloFuckingWorld ",
+      "    - hello_fucking_world",
+      "    - helloFuckingWorld",
+      "    - tcp",
+      "---",
+      "## First off, Hello world!",
+      "Say Hello",
+      "",
+      "Some prose that is long enough to look like a paragraph of a note.",
+    };
+}
+
+std::vector<std::string> prose_note()
+{
+    std::vector<std::string> lines{"# A long note", "#tagLine #anotherTag"};
+    for(int i = 0; i < 40; ++i)
+    {
+        lines.push_back(i % 8 ? "Lorem ipsum dolor sit amet, consectetur "
+                                "adipiscing elit, sed do eiusmod tempor."
+                              : "see #someTag and `code #x` http://a.io/#frag");
+    }
+    return lines;
+}
+
+// best of 5, in milliseconds
+long bench(const char *name, const std::vector<std::string> &note, int num,
+           bool inline_tags)
+{
+    long best = LONG_MAX;
+    size_t num_of_tags = 0;
+    for(int round = 0; round < 5; ++round)
+    {
+        std::vector<std::shared_ptr<loaded_text>> texts;
+        for(int i = 0; i < num; ++i)
+        {
+            auto mt = loaded_text::create();
+            mt->lines = note;
+            texts.push_back(mt);
+        }
+        num_of_tags = 0;
+        auto start = bench_clock::now();
+        for(auto &mt : texts)
+        {
+            num_of_tags
+              += parse_text(mt, tag_style::snake, inline_tags).second.size();
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+          bench_clock::now() - start);
+        best = std::min(best, static_cast<long>(elapsed.count()));
+    }
+    printf("%-16s %8d notes %10zu tags %8ld ms\n", name, num, num_of_tags,
+           best);
+    return best;
+}
+
+// the same 2000 spellings num times, with and without the tag cache
+void bench_convert(int num)
+{
+    std::vector<std::string> spellings;
+    for(int i = 0; i < 2000; ++i)
+    {
+        spellings.push_back("#someTag" + std::to_string(i) + "-of_Mine");
+    }
+    for(auto convert : {convert_tag_, convert_tag})
+    {
+        size_t total = 0;
+        auto start = bench_clock::now();
+        for(int i = 0; i < num; ++i)
+        {
+            total += convert(spellings[i % spellings.size()], tag_style::snake)
+                       .size();
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+          bench_clock::now() - start);
+        printf("%-16s %8d tags %10zu chars %8ld ms\n",
+               convert == convert_tag ? "convert cached" : "convert", num,
+               total, static_cast<long>(elapsed.count()));
+    }
+}
+
+int main(int argc, const char **argv)
+{
+    int num = argc > 1 ? atoi(argv[1]) : 100000;
+    bench("yaml", yaml_note(), num, false);
+    bench("prose", prose_note(), num / 10, false);
+    bench("prose --inline", prose_note(), num / 10, true);
+    bench_convert(num * 10);
+
+    auto [front_hits, shared_hits, misses] = tag_cache_counts();
+    auto lookups = front_hits + shared_hits + misses;
+    printf("tag cache: %lu lookups, %.2f%% front hits, %.2f%% shared hits, "
+           "%lu misses\n",
+           lookups, 100.0 * front_hits / lookups, 100.0 * shared_hits / lookups,
+           misses);
+}
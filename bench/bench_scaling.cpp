@@ -0,0 +1,200 @@
+// Scaling benchmark
+// ===========================
+//
+// Runs the morg binary over generated vaults at several -j values and
+// reports wall time, CPU time and peak RSS of each run, the median of
+// the repetitions. With --baseline, another morg binary runs the same
+// vaults and the report compares the two.
+//
+// Every run gets a freshly generated vault, since morg rewrites notes.
+
+#include <morg/gen.h>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace morg;
+
+struct measurement
+{
+    double wall_ms;
+    double cpu_ms;
+    long peak_rss_kb;
+};
+
+measurement run_morg(const std::string &morg,
+                     const std::filesystem::path &vault, int jobs)
+{
+    auto out = vault / "morg_out";
+    std::string j = std::to_string(jobs);
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        execl(morg.c_str(), morg.c_str(), "-d", vault.c_str(), "-j", j.c_str(),
+              "-O", out.c_str(), nullptr);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    auto wall = std::chrono::steady_clock::now() - start;
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "%s failed on %s\n", morg.c_str(), vault.c_str());
+        exit(1);
+    }
+    auto ms = [](const timeval &t) { return t.tv_sec * 1e3 + t.tv_usec / 1e3; };
+    return {std::chrono::duration<double, std::milli>(wall).count(),
+            ms(usage.ru_utime) + ms(usage.ru_stime), usage.ru_maxrss};
+}
+
+measurement median(std::vector<measurement> runs)
+{
+    auto mid = runs.size() / 2;
+    auto nth = [&](auto field) {
+        std::vector<double> v;
+        for(auto &r : runs)
+            v.push_back(r.*field);
+        std::nth_element(v.begin(), v.begin() + mid, v.end());
+        return v[mid];
+    };
+    std::vector<long> rss;
+    for(auto &r : runs)
+        rss.push_back(r.peak_rss_kb);
+    std::nth_element(rss.begin(), rss.begin() + mid, rss.end());
+    return {nth(&measurement::wall_ms), nth(&measurement::cpu_ms), rss[mid]};
+}
+
+void usage_and_die(const char *prog, int errnum, const char *errmsg)
+{
+    std::cout << prog << ": " << errmsg <<
+      R""""(
+Usage: morg_bench_scaling [OPTIONS]
+
+    -h, --help      this message
+    --morg          the morg binary to measure
+    --baseline      another morg binary to compare against
+    -j              comma separated job counts          [1,2,4,8]
+    -n              files of the many-small-files vault [20000]
+    -r              repetitions, the median is reported [3]
+    -o              also write the report to this file
+)"""" << std::endl;
+    exit(errnum);
+}
+
+int main(int argc, const char **argv)
+{
+#ifdef MORG_BINARY
+    std::string morg = MORG_BINARY;
+#else
+    std::string morg = "./morg";
+#endif
+    std::string baseline;
+    std::vector<int> jobs{1, 2, 4, 8};
+    uint32_t num_of_files = 20000;
+    int reps = 3;
+    std::filesystem::path report_file;
+    for(int i = 1; i < argc; ++i)
+    {
+        const char *opt = argv[i];
+        if(!strcmp(opt, "--help") || !strcmp(opt, "-h"))
+            usage_and_die(argv[0], 0, "");
+        if(i + 1 >= argc)
+            usage_and_die(argv[0], -1, "Missing value");
+        const char *value = argv[++i];
+        if(!strcmp(opt, "--morg"))
+            morg = value;
+        else if(!strcmp(opt, "--baseline"))
+            baseline = value;
+        else if(!strcmp(opt, "-j"))
+        {
+            jobs.clear();
+            std::istringstream iss(value);
+            for(std::string j; std::getline(iss, j, ',');)
+                jobs.push_back(atoi(j.c_str()));
+        }
+        else if(!strcmp(opt, "-n"))
+            num_of_files = atoi(value);
+        else if(!strcmp(opt, "-r"))
+            reps = std::max(1, atoi(value));
+        else if(!strcmp(opt, "-o"))
+            report_file = value;
+        else
+            usage_and_die(argv[0], -1, "Invalid Options");
+    }
+
+    // many small notes, and a few long ones of the same total size
+    std::vector<std::pair<std::string, vault_spec>> vaults(2);
+    vaults[0].first = "many small";
+    vaults[0].second.num_of_files = num_of_files;
+    vaults[0].second.median_lines = 15;
+    vaults[1].first = "few large";
+    vaults[1].second.num_of_files = std::max(1u, num_of_files / 100);
+    vaults[1].second.median_lines = 1500;
+    vaults[1].second.tags_per_file = 40;
+
+    std::vector<std::pair<std::string, std::string>> binaries{{"morg", morg}};
+    if(!baseline.empty())
+        binaries.emplace_back("baseline", baseline);
+
+    auto work = std::filesystem::temp_directory_path() / "morg_bench_scaling";
+    std::ostringstream report;
+    report << "| vault | binary | -j | wall ms | cpu ms | peak RSS MB "
+              "| speedup | vs baseline |\n"
+           << "|---|---|---:|---:|---:|---:|---:|---:|\n";
+    for(auto &[vault_name, spec] : vaults)
+    {
+        std::map<std::pair<std::string, int>, measurement> results;
+        for(auto &[name, binary] : binaries)
+        {
+            for(int j : jobs)
+            {
+                std::vector<measurement> runs;
+                for(int r = 0; r < reps; ++r)
+                {
+                    std::filesystem::remove_all(work);
+                    generate_vault(spec, work);
+                    runs.push_back(run_morg(binary, work, j));
+                }
+                results[{name, j}] = median(runs);
+                fprintf(stderr, "%s, %s -j %d: %.1f ms\n", vault_name.c_str(),
+                        name.c_str(), j, results[{name, j}].wall_ms);
+            }
+        }
+        for(auto &[name, binary] : binaries)
+        {
+            for(int j : jobs)
+            {
+                auto &m = results[{name, j}];
+                auto &one = results[{name, jobs.front()}];
+                char line[256];
+                snprintf(line, sizeof(line),
+                         "| %s | %s | %d | %.1f | %.1f | %.1f | %.2fx |",
+                         vault_name.c_str(), name.c_str(), j, m.wall_ms,
+                         m.cpu_ms, m.peak_rss_kb / 1024.0,
+                         one.wall_ms / m.wall_ms);
+                report << line;
+                if(name != "baseline" && !baseline.empty())
+                {
+                    snprintf(line, sizeof(line), " %.2fx |",
+                             results[{"baseline", j}].wall_ms / m.wall_ms);
+                    report << line << "\n";
+                }
+                else
+                {
+                    report << " |\n";
+                }
+            }
+        }
+    }
+    std::filesystem::remove_all(work);
+
+    std::cout << report.str();
+    if(!report_file.empty())
+        std::ofstream(report_file) << report.str();
+}
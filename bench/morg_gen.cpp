@@ -0,0 +1,90 @@
+// morg_gen
+// ===========================
+//
+// Generates a synthetic vault, see morg/gen.h
+
+#include <morg/gen.h>
+
+using namespace morg;
+
+void usage_and_die(const char *prog, int errnum, const char *errmsg)
+{
+    std::cout << prog << ": " << errmsg <<
+      R""""(
+Usage: morg_gen -O DIR [OPTIONS]
+
+    -h, --help          this message
+    -O                  output directory, must not exist
+    -n                  number of files                     [1000]
+    --lines             median lines per file               [40]
+    --lines-sigma       spread of the file sizes            [0.8]
+    --tags              tags per file                       [4]
+    --vocabulary        distinct tags                       [2000]
+    --styles            weights of snake,camel,Camel,kebab  [1,1,1,1]
+    --frontmatter       ratio of files with frontmatter     [0.5]
+    --code              ratio of files with a code block    [0.2]
+    --links             wiki-links per file                 [2]
+    --depth             directory depth, morg itself only   [0]
+                        reads the top level of a vault
+    --seed              random seed                         [1]
+)"""" << std::endl;
+    exit(errnum);
+}
+
+int main(int argc, const char **argv)
+{
+    vault_spec spec;
+    std::filesystem::path root;
+    for(int i = 1; i < argc; ++i)
+    {
+        const char *opt = argv[i];
+        if(!strcmp(opt, "--help") || !strcmp(opt, "-h"))
+            usage_and_die(argv[0], 0, "");
+        if(i + 1 >= argc)
+            usage_and_die(argv[0], -1, "Missing value");
+        const char *value = argv[++i];
+        if(!strcmp(opt, "-O"))
+            root = value;
+        else if(!strcmp(opt, "-n"))
+            spec.num_of_files = atoi(value);
+        else if(!strcmp(opt, "--lines"))
+            spec.median_lines = atof(value);
+        else if(!strcmp(opt, "--lines-sigma"))
+            spec.sigma_lines = atof(value);
+        else if(!strcmp(opt, "--tags"))
+            spec.tags_per_file = atof(value);
+        else if(!strcmp(opt, "--vocabulary"))
+            spec.vocabulary = atoi(value);
+        else if(!strcmp(opt, "--styles"))
+        {
+            if(sscanf(value, "%lf,%lf,%lf,%lf", &spec.style_mix[0],
+                      &spec.style_mix[1], &spec.style_mix[2],
+                      &spec.style_mix[3])
+               != 4)
+                usage_and_die(argv[0], -2, "Invalid style weights");
+        }
+        else if(!strcmp(opt, "--frontmatter"))
+            spec.frontmatter_ratio = atof(value);
+        else if(!strcmp(opt, "--code"))
+            spec.code_block_ratio = atof(value);
+        else if(!strcmp(opt, "--links"))
+            spec.links_per_file = atof(value);
+        else if(!strcmp(opt, "--depth"))
+            spec.depth = atoi(value);
+        else if(!strcmp(opt, "--seed"))
+            spec.seed = strtoull(value, nullptr, 10);
+        else
+            usage_and_die(argv[0], -1, "Invalid Options");
+    }
+    if(root.empty())
+        usage_and_die(argv[0], -3, "No output directory");
+    if(std::filesystem::exists(root))
+        usage_and_die(argv[0], -4, "Output directory exists");
+    if(spec.depth < 0 || spec.vocabulary == 0)
+        usage_and_die(argv[0], -5, "Invalid depth or vocabulary");
+    if(spec.depth > 0)
+        fprintf(stderr, "%s: warning: morg does not descend into directories, "
+                        "notes below the top level are never processed\n",
+                argv[0]);
+    generate_vault(spec, root);
+}
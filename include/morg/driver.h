@@ -3,7 +3,10 @@
 
 namespace morg
 {
-void create_roadmap(std::filesystem::path path, pair_tag_loaded_texts &roadmap)
+// related: tags sharing files with this one, and how many files
+void create_roadmap(std::filesystem::path path, pair_tag_loaded_texts &roadmap,
+                    const std::vector<std::pair<std::string, uint32_t>> &related
+                    = {})
 {
     std::string tag = roadmap.first;
     path /= std::string("__") + tag + ".md";
@@ -15,6 +18,72 @@ void create_roadmap(std::filesystem::path path, pair_tag_loaded_texts &roadmap)
     {
         out << "- [[" << mt->path.filename().c_str() << "]]" << std::endl;
     }
+    if(related.empty())
+        return;
+    out << std::endl << "## related" << std::endl << std::endl;
+    for(auto &[other, count] : related)
+    {
+        out << "- [[__" << other << ".md]] (" << count << ")" << std::endl;
+    }
+}
+
+// One index for the whole vault, a note is listed under every note it
+// links to. Links are matched by file name, with or without ".md",
+// links to anything outside the vault are dropped
+void create_backlinks(std::filesystem::path path, file_table &files)
+{
+    std::map<std::string, uint32_t> by_name;
+    for(uint32_t i = 0; i < files.size(); ++i)
+    {
+        by_name.emplace(files.texts[i]->path.stem().string(), i);
+    }
+    std::vector<std::vector<uint32_t>> backlinks(files.size());
+    for(uint32_t i = 0; i < files.size(); ++i)
+    {
+        for(auto &target : files.links[i])
+        {
+            std::string_view name = target;
+            if(name.ends_with(".md"))
+                name.remove_suffix(3);
+            auto found = by_name.find(std::string{name});
+            if(found != by_name.end() && found->second != i)
+            {
+                backlinks[found->second].push_back(i);
+            }
+        }
+    }
+
+    auto by_path = [&files](uint32_t a, uint32_t b) {
+        return files.texts[a]->path < files.texts[b]->path;
+    };
+    std::vector<uint32_t> targets;
+    for(uint32_t i = 0; i < files.size(); ++i)
+    {
+        auto &sources = backlinks[i];
+        if(sources.empty())
+            continue;
+        std::sort(sources.begin(), sources.end(), by_path);
+        sources.erase(std::unique(sources.begin(), sources.end()),
+                      sources.end());
+        targets.push_back(i);
+    }
+    std::sort(targets.begin(), targets.end(), by_path);
+
+    path /= "__backlinks.md";
+    std::ofstream out(path, std::ios::out);
+    out << "# backlinks" << std::endl;
+    for(auto target : targets)
+    {
+        out << std::endl
+            << "## [[" << files.texts[target]->path.filename().c_str() << "]]"
+            << std::endl
+            << std::endl;
+        for(auto source : backlinks[target])
+        {
+            out << "- [[" << files.texts[source]->path.filename().c_str()
+                << "]]" << std::endl;
+        }
+    }
 }
 
 void over_write(std::shared_ptr<loaded_text> mt)
@@ -34,6 +103,7 @@ void over_write(std::shared_ptr<loaded_text> mt)
 //   retire
 void do_work(worker w)
 {
+    trace_thread_name("Worker " + std::to_string(w.id));
     for(;;)
     {
         task_t task;
@@ -42,12 +112,18 @@ void do_work(worker w)
             switch(task.type)
             {
             case task_type::new_file: {
-                std::shared_ptr<loaded_text> mt
-                  = std::get<std::shared_ptr<loaded_text>>(task.value);
+                auto &mt = w.files->texts[task.value];
                 LOG("[thread %d]: Process File <%s>\n", w.id,
                     mt->path.c_str());
+                auto links
+                  = w.ctx.backlinks ? &w.files->links[task.value] : nullptr;
+                {
+                    trace_span span("parse_text", task.value);
+                    w.files->tags[task.value]
+                      = parse_text(mt, w.ctx.ts, w.ctx.inline_tags, links)
+                          .second;
+                }
                 task.type = task_type::parsing_is_done;
-                task.value = parse_text(mt, w.ctx.ts);
                 w.to_manager->enqueue(task);
                 break;
             }
@@ -61,18 +137,144 @@ void do_work(worker w)
     }
 }
 
-void collect(manager_t &manager, pair_loaded_text_tags &item)
+void collect(manager_t &manager, uint32_t file)
 {
     map_tag_loaded_texts &map = manager.dict;
-    auto mt = item.first;
-    manager.texts.push_back(mt);
-    auto tags = item.second;
-    for(auto &tag : tags)
+    auto &mt = manager.files->texts[file];
+    for(auto &tag : manager.files->tags[file])
     {
         map[tag].push_back(mt);
     }
 }
 
+// call f(thread, i) for every i in [0, n), the threads take i in chunks
+template <typename F>
+void parallel_for(size_t n, int num_of_threads, F f, size_t chunk = 64)
+{
+    std::atomic<size_t> next{0};
+    auto take_chunks = [&](int thread) {
+        for(;;)
+        {
+            size_t first = next.fetch_add(chunk);
+            if(first >= n)
+                return;
+            size_t last = std::min(first + chunk, n);
+            for(size_t i = first; i < last; ++i)
+            {
+                f(thread, i);
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for(int i = 1; i < num_of_threads; ++i)
+    {
+        threads.emplace_back(take_chunks, i);
+    }
+    take_chunks(0);
+    for(auto &t : threads)
+    {
+        t.join();
+    }
+}
+
+// Entries arrive in the order the workers finish, so sort them by path,
+// then the roadmaps come out the same whatever -j is
+void sort_roadmaps(map_tag_loaded_texts &dict, int num_of_threads)
+{
+    std::vector<std::vector<std::shared_ptr<loaded_text>> *> roadmaps;
+    roadmaps.reserve(dict.size());
+    for(auto &[tag, texts] : dict)
+    {
+        roadmaps.push_back(&texts);
+    }
+    parallel_for(roadmaps.size(), num_of_threads, [&](int, size_t i) {
+        auto &texts = *roadmaps[i];
+        std::sort(texts.begin(), texts.end(),
+                  [](auto &a, auto &b) { return a->path < b->path; });
+        // a file that repeats a tag is listed once
+        texts.erase(std::unique(texts.begin(), texts.end()), texts.end());
+    });
+}
+
+// Tag co-occurrence
+// ===========================
+//
+// For each tag, the k tags sharing the most files with it, indexed like
+// the tags of dict. Only pairs that occur are counted, no dense matrix.
+// Every thread counts into its own shards, where shard s holds the pairs
+// (a, b) with a % num_of_threads == s, then thread s merges shard s of
+// all threads and ranks the tags of that shard
+using related_tags_t = std::vector<std::vector<std::pair<uint32_t, uint32_t>>>;
+
+related_tags_t related_tags(const map_tag_loaded_texts &dict,
+                            const file_table &files, size_t k,
+                            int num_of_threads)
+{
+    std::unordered_map<std::string_view, uint32_t> ids;
+    for(auto &[tag, texts] : dict)
+    {
+        ids.emplace(tag, ids.size());
+    }
+    size_t num_of_shards = num_of_threads;
+    using counter = std::unordered_map<uint64_t, uint32_t>;
+    std::vector<std::vector<counter>> shards(
+      num_of_threads, std::vector<counter>(num_of_shards));
+
+    parallel_for(files.size(), num_of_threads, [&](int thread, size_t file) {
+        std::vector<uint32_t> tags;
+        for(auto &tag : files.tags[file])
+        {
+            tags.push_back(ids.at(tag));
+        }
+        std::sort(tags.begin(), tags.end());
+        tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+        auto &own = shards[thread];
+        for(auto a : tags)
+        {
+            auto &shard = own[a % num_of_shards];
+            for(auto b : tags)
+            {
+                if(a != b)
+                    ++shard[static_cast<uint64_t>(a) << 32 | b];
+            }
+        }
+    });
+
+    related_tags_t related(ids.size());
+    parallel_for(
+      num_of_shards, num_of_threads,
+      [&](int, size_t s) {
+          counter merged = std::move(shards[0][s]);
+          for(int t = 1; t < num_of_threads; ++t)
+          {
+              for(auto &[pair, count] : shards[t][s])
+              {
+                  merged[pair] += count;
+              }
+              counter{}.swap(shards[t][s]);
+          }
+          // (a, count, b), most shared first, ties by name
+          std::vector<std::tuple<uint32_t, uint32_t, uint32_t>> pairs;
+          pairs.reserve(merged.size());
+          for(auto &[pair, count] : merged)
+          {
+              pairs.emplace_back(pair >> 32, count, pair & 0xffffffff);
+          }
+          std::sort(pairs.begin(), pairs.end(), [](auto &x, auto &y) {
+              auto &[a1, c1, b1] = x;
+              auto &[a2, c2, b2] = y;
+              return std::tie(a1, c2, b1) < std::tie(a2, c1, b2);
+          });
+          for(auto &[a, count, b] : pairs)
+          {
+              if(related[a].size() < k)
+                  related[a].emplace_back(b, count);
+          }
+      },
+      1);
+    return related;
+}
+
 // The Relay must run as soon as workers runs,
 // because while Taskspawner is dispatching tasks,
 // the workers might have finished some of them,
@@ -80,6 +282,7 @@ void collect(manager_t &manager, pair_loaded_text_tags &item)
 // this someone is designated to be the relay
 void relay(manager_t manager)
 {
+    trace_thread_name("Relay");
     int t2ps_cnt = 0;
     int total_t2ps = INT_MAX;
     task_t task;
@@ -91,11 +294,14 @@ void relay(manager_t manager)
             {
             case task_type::parsing_is_done: {
                 ++t2ps_cnt;
-                collect(manager, std::get<pair_loaded_text_tags>(task.value));
+                trace_counter("to_worker", manager.to_worker->size_approx());
+                trace_counter("to_manager", manager.to_manager->size_approx());
+                trace_span span("collect", task.value);
+                collect(manager, task.value);
                 break;
             }
             case task_type::all_files_are_sent: {
-                int num = std::get<int>(task.value);
+                int num = task.value;
                 LOG("[manager]: Notified by TaskSpawner, "
                     "there will be %d "
                     "Files\n",
@@ -116,20 +322,53 @@ void relay(manager_t manager)
             manager.to_worker->enqueue(task);
         }
     });
-    mt.detach();
 
+    {
+        trace_span span("sort_roadmaps");
+        sort_roadmaps(manager.dict, manager.ctx.num_of_workers);
+    }
+    related_tags_t related;
+    std::vector<std::string> names;
+    if(manager.ctx.related_tags > 0)
+    {
+        trace_span span("related_tags");
+        related = related_tags(manager.dict, *manager.files,
+                               manager.ctx.related_tags,
+                               manager.ctx.num_of_workers);
+        for(auto &[tag, texts] : manager.dict)
+        {
+            names.push_back(tag);
+        }
+    }
+    size_t id = 0;
     for(pair_tag_loaded_texts i : manager.dict)
     {
-        create_roadmap(manager.ctx.output_dir, i);
+        std::vector<std::pair<std::string, uint32_t>> related_to_i;
+        if(!related.empty())
+        {
+            for(auto &[other, count] : related[id])
+            {
+                related_to_i.emplace_back(names[other], count);
+            }
+        }
+        trace_span span("create_roadmap");
+        create_roadmap(manager.ctx.output_dir, i, related_to_i);
+        ++id;
     }
     LOG("%lu RoadMaps Generated\n", manager.dict.size());
-    LOG("%lu Files\n", manager.texts.size());
-    for(auto i : manager.texts)
+    if(manager.ctx.backlinks)
     {
-        over_write(i);
+        trace_span span("create_backlinks");
+        create_backlinks(manager.ctx.output_dir, *manager.files);
     }
-
-    return;
+    LOG("%lu Files\n", manager.files->size());
+    for(uint32_t i = 0; i < manager.files->size(); ++i)
+    {
+        trace_span span("over_write", i);
+        over_write(manager.files->texts[i]);
+    }
+    // the queues must outlive every thread that touches them
+    mt.join();
 }
 
 std::vector<std::filesystem::path> glob(std::filesystem::path &path)
@@ -161,12 +400,16 @@ std::vector<std::filesystem::path> glob(std::filesystem::path &path)
 // act like Linux `find`
 void find_and_load(manager_t manager)
 {
+    trace_thread_name("TaskSpawner");
     task_t task{task_type::new_file, 0};
     // for now just search files within the root_dir with depth 1
     auto files = glob(manager.ctx.root_dir);
-    int num = files.size();
-    for(auto f : files)
+    uint32_t num = files.size();
+    // every slot exists before any worker can see a task
+    manager.files->resize(num);
+    for(auto &f : files)
     {
+        trace_span span("load", task.value);
         std::ifstream infile(f);
         std::string line;
         std::vector<std::string> text;
@@ -176,18 +419,47 @@ void find_and_load(manager_t manager)
         }
         auto mt = loaded_text::create();
         mt->path = f;
-        mt->lines = text;
-        task.value = mt;
+        mt->lines = std::move(text);
+        manager.files->texts[task.value] = mt;
         LOG("[TaskSpawner]: New task: %s\n", f.c_str());
         manager.to_worker->enqueue(task);
+        ++task.value;
     }
     // tell relay the number of files,
     // but the first character to receive it is worker,
     // any worker that receive this must forward it to the Relay
     task.type = task_type::all_files_are_sent;
     task.value = num;
-    LOG("[TaskSpawner]: All %d files are sent\n", num);
+    LOG("[TaskSpawner]: All %u files are sent\n", num);
     manager.to_manager->enqueue(task);
 }
 
+void run(context &ctx)
+{
+    if(!ctx.trace_file.empty())
+        trace_start();
+    queue q1;
+    queue q2;
+    file_table files;
+    std::vector<std::thread> workers;
+    for(int i = 0; i < ctx.num_of_workers; ++i)
+    {
+        worker worker(i + 1, &q1, &q2, &files, ctx);
+        workers.push_back(std::thread{do_work, worker});
+    }
+    // Spawner thread finishes finding all files and exit immediately
+    std::thread spawner(find_and_load, manager_t(&q1, &q2, &files, ctx));
+    // Relay thread
+    manager_t relayctl(&q1, &q2, &files, ctx);
+    std::thread(relay, relayctl).join();
+    spawner.join();
+
+    for(auto &t : workers)
+    {
+        t.join();
+    }
+    if(!ctx.trace_file.empty())
+        trace_write(ctx.trace_file, files);
+}
+
 }
\ No newline at end of file
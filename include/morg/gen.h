@@ -0,0 +1,238 @@
+#pragma once
+// Vault generator
+// ===========================
+//
+// Writes a synthetic vault shaped like a real one, for benchmarks.
+// The same spec always gives the same bytes: only the raw output of
+// mt19937_64 is used, which the standard pins down, and the
+// distributions on top of it are done by hand, since those of <random>
+// differ between standard libraries
+
+#include <morg/types.h>
+
+namespace morg
+{
+struct vault_spec
+{
+    uint32_t num_of_files = 1000;
+    // lines per file are log-normal around this median
+    double median_lines = 40;
+    double sigma_lines = 0.8;
+    // on average
+    double tags_per_file = 4;
+    // distinct tags, a few of them far more popular than the rest
+    uint32_t vocabulary = 2000;
+    // weights of snake_case, camelCase, CamelCase and kebab-case spellings
+    double style_mix[4] = {1, 1, 1, 1};
+    double frontmatter_ratio = 0.5;
+    double code_block_ratio = 0.2;
+    // [[wiki-links]] per file, on average
+    double links_per_file = 2;
+    // notes are spread up to this many directories deep, 0 for flat,
+    // morg only globs the top level, so deeper notes are not processed
+    int depth = 0;
+    uint64_t seed = 1;
+};
+
+struct gen_rng
+{
+    std::mt19937_64 engine;
+    explicit gen_rng(uint64_t seed) : engine(seed) {}
+
+    // [0, 1)
+    double uniform() { return (engine() >> 11) * 0x1.0p-53; }
+    uint64_t below(uint64_t n) { return n ? engine() % n : 0; }
+    bool chance(double p) { return uniform() < p; }
+    double normal()
+    {
+        // Box-Muller
+        double u = 1.0 - uniform();
+        double v = uniform();
+        return std::sqrt(-2.0 * std::log(u)) * std::cos(2 * M_PI * v);
+    }
+    // a count around mean, never negative
+    uint32_t count(double mean)
+    {
+        return static_cast<uint32_t>(2 * mean * uniform() + 0.5);
+    }
+};
+
+const char *GEN_WORDS[] = {
+  "alpha",   "bridge", "cache",   "delta",  "engine",  "fiber",   "graph",
+  "hash",    "index",  "joint",   "kernel", "lambda",  "memory",  "network",
+  "object",  "parser", "queue",   "rust",   "socket",  "thread",  "unicode",
+  "vector",  "window", "xml",     "yield",  "zettel",  "book",    "cooking",
+  "design",  "essay",  "finance", "garden", "history", "idea",    "journal",
+  "kotlin",  "linux",  "music",   "note",   "opera",   "physics", "quote",
+  "reading", "sport",  "travel",  "urban",  "video",   "writing", "math",
+  "poem",    "recipe", "review",  "talk",   "paper",   "draft",   "todo",
+  "work",    "home",   "health",  "film",   "game",    "code",    "art",
+  "science"};
+const size_t NUM_OF_GEN_WORDS = sizeof(GEN_WORDS) / sizeof(GEN_WORDS[0]);
+
+// the words of tag i, e.g. {"graph", "kernel"}
+std::vector<std::string> gen_tag_words(uint32_t i)
+{
+    std::vector<std::string> words{GEN_WORDS[i % NUM_OF_GEN_WORDS]};
+    i /= NUM_OF_GEN_WORDS;
+    words.push_back(GEN_WORDS[i % NUM_OF_GEN_WORDS]);
+    i /= NUM_OF_GEN_WORDS;
+    if(i)
+        words.push_back(std::to_string(i));
+    return words;
+}
+
+// spelled in a style picked by style_mix, without '#'
+std::string gen_tag(const vault_spec &spec, gen_rng &rng)
+{
+    // cubing makes low indexes popular
+    double u = rng.uniform();
+    auto words
+      = gen_tag_words(static_cast<uint32_t>(spec.vocabulary * u * u * u));
+
+    double total = 0;
+    for(double w : spec.style_mix)
+        total += w;
+    double pick = rng.uniform() * total;
+    int style = 0;
+    while(style < 3 && pick >= spec.style_mix[style])
+    {
+        pick -= spec.style_mix[style];
+        ++style;
+    }
+
+    std::string tag;
+    for(size_t i = 0; i < words.size(); ++i)
+    {
+        std::string w = words[i];
+        if(i > 0 && style == 0)
+            tag.push_back('_');
+        if(i > 0 && style == 3)
+            tag.push_back('-');
+        if((i > 0 && style == 1) || style == 2)
+            w[0] = std::toupper(w[0]);
+        tag.append(w);
+    }
+    return tag;
+}
+
+std::string gen_prose(gen_rng &rng)
+{
+    std::string line;
+    for(int n = 8 + rng.below(8); n > 0; --n)
+    {
+        line.append(GEN_WORDS[rng.below(NUM_OF_GEN_WORDS)]);
+        line.push_back(' ');
+    }
+    line.back() = '.';
+    line[0] = std::toupper(line[0]);
+    return line;
+}
+
+std::filesystem::path gen_note_path(const vault_spec &spec, gen_rng &rng,
+                                    uint32_t i)
+{
+    std::filesystem::path path;
+    for(int d = rng.below(spec.depth + 1); d > 0; --d)
+    {
+        path /= "dir" + std::to_string(rng.below(4));
+    }
+    return path / ("note" + std::to_string(i) + ".md");
+}
+
+std::vector<std::string> gen_note(const vault_spec &spec, gen_rng &rng,
+                                  uint32_t i)
+{
+    uint32_t num_of_lines = std::max(
+      1.0, spec.median_lines * std::exp(spec.sigma_lines * rng.normal()));
+    std::vector<std::string> body;
+    for(uint32_t l = 0; l < num_of_lines; ++l)
+    {
+        body.push_back(gen_prose(rng));
+    }
+
+    std::vector<std::string> yaml_tags;
+    for(uint32_t t = rng.count(spec.tags_per_file); t > 0; --t)
+    {
+        auto tag = gen_tag(spec, rng);
+        auto where = rng.below(3);
+        if(where == 0)
+        {
+            yaml_tags.push_back(tag);
+        }
+        else if(where == 1)
+        {
+            // a line of tags
+            body.insert(body.begin() + rng.below(body.size()), "#" + tag);
+        }
+        else
+        {
+            body[rng.below(body.size())].append(" #" + tag);
+        }
+    }
+    for(uint32_t l = rng.count(spec.links_per_file); l > 0; --l)
+    {
+        body[rng.below(body.size())].append(
+          " see [[note" + std::to_string(rng.below(spec.num_of_files)) + "]]");
+    }
+    if(rng.chance(spec.code_block_ratio))
+    {
+        auto at = body.begin() + rng.below(body.size());
+        body.insert(at, {"```cpp", "#include <cstdio>", "#define TAG 1",
+                         "int main() { return TAG; }", "```"});
+    }
+
+    std::vector<std::string> lines;
+    bool frontmatter = rng.chance(spec.frontmatter_ratio);
+    if(frontmatter)
+    {
+        lines.push_back("---");
+        lines.push_back("title: note " + std::to_string(i));
+        bool block_list = rng.chance(0.5);
+        if(!yaml_tags.empty() && block_list)
+        {
+            lines.push_back("tags:");
+            for(auto &tag : yaml_tags)
+                lines.push_back("  - " + tag);
+        }
+        else if(!yaml_tags.empty())
+        {
+            std::string flow = "tags: [";
+            for(auto &tag : yaml_tags)
+                flow += tag + ", ";
+            flow.resize(flow.size() - 2);
+            lines.push_back(flow + "]");
+        }
+        lines.push_back("---");
+    }
+    else if(!yaml_tags.empty())
+    {
+        // no frontmatter to hold them, make them a tag line
+        std::string tag_line;
+        for(auto &tag : yaml_tags)
+            tag_line += "#" + tag + " ";
+        tag_line.pop_back();
+        body.insert(body.begin(), tag_line);
+    }
+    lines.push_back("# note " + std::to_string(i));
+    lines.insert(lines.end(), body.begin(), body.end());
+    return lines;
+}
+
+void generate_vault(const vault_spec &spec, const std::filesystem::path &root)
+{
+    gen_rng rng(spec.seed);
+    std::filesystem::create_directories(root);
+    for(uint32_t i = 0; i < spec.num_of_files; ++i)
+    {
+        auto path = root / gen_note_path(spec, rng, i);
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream out(path, std::ios::out);
+        for(auto &line : gen_note(spec, rng, i))
+        {
+            out << line << '\n';
+        }
+    }
+}
+
+}
@@ -24,6 +24,7 @@
 #endif
 #include <morg/types.h>
 #include <morg/parser.h>
+#include <morg/trace.h>
 #include <morg/driver.h>
 
 
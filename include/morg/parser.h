@@ -15,6 +15,10 @@ Usage: morg [OPTIONS]
     -j              number of jobs
     -O              output directory
     -t, --tag-style options: snake_case, CamelCase, camelCase
+    -i, --inline    also collect tags written inside prose
+    -b, --backlinks write an index of the wiki-links between notes
+    -r, --related   list this many related tags in each roadmap
+    --trace         write a Chrome trace of the run to this file
 )"""" << std::endl;
     exit(errnum);
 }
@@ -99,6 +103,26 @@ context parse_context(int argc, const char **argv)
                     HELP_AND_DIE(argv[0], -5, "Invalid tag style %s", style);
                 }
             }
+            else if(!strcmp(argv[i], "--inline") || !strcmp(argv[i], "-i"))
+            {
+                ctx.inline_tags = true;
+            }
+            else if(!strcmp(argv[i], "--backlinks") || !strcmp(argv[i], "-b"))
+            {
+                ctx.backlinks = true;
+            }
+            else if(!strcmp(argv[i], "--related") || !strcmp(argv[i], "-r"))
+            {
+                ctx.related_tags = atoi(argv[++i]);
+                if(ctx.related_tags < 0)
+                {
+                    HELP_AND_DIE(argv[0], -6, "Invalid number of related tags");
+                }
+            }
+            else if(!strcmp(argv[i], "--trace"))
+            {
+                ctx.trace_file = argv[++i];
+            }
             else if(!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h"))
             {
                 HELP_AND_DIE(argv[0], 0, "%s", "");
@@ -184,6 +208,8 @@ std::string make_upper_camel(std::string &tag)
     auto tags = split_tag(tag);
     std::string new_tag = "";
     std::for_each(tags.begin(), tags.end(), [&](std::string &s) {
+        if(s.empty())
+            return;
         std::for_each(s.begin() + 1, s.end(),
                       [](char &s) { s = std::tolower(s); });
         s[0] = std::toupper(s[0]);
@@ -197,6 +223,8 @@ std::string make_lower_camel(std::string &tag)
     auto tags = split_tag(tag);
     std::string new_tag = "";
     std::for_each(tags.begin(), tags.end(), [&](std::string &s) {
+        if(s.empty())
+            return;
         std::for_each(s.begin() + 1, s.end(),
                       [](char &s) { s = std::tolower(s); });
         s[0] = std::toupper(s[0]);
@@ -211,12 +239,15 @@ std::string make_delimited_case(std::string &tag, char delimiter)
     auto words = split_tag(tag);
     std::string new_tag = "";
     std::for_each(words.begin(), words.end(), [&](std::string &s) {
+        if(s.empty())
+            return;
         std::for_each(s.begin(), s.end(),
                       [](char &s) { s = std::tolower(s); });
         new_tag.append(s);
-        new_tag.append(delimiter);
+        new_tag.push_back(delimiter);
     });
-    new_tag.pop_back(); // remove last delimiter
+    if(!new_tag.empty())
+        new_tag.pop_back(); // remove last delimiter
     return new_tag;
 }
 
@@ -230,6 +261,122 @@ std::string make_kebab_case(std::string &tag)
     return make_delimited_case(tag, '-');
 }
 
+// the tag must carry its prefix, '#' or ' ', see split_tag
+std::string convert_tag_(std::string &tag, tag_style ts)
+{
+    switch(ts)
+    {
+    case tag_style::snake: return make_snake_case(tag);
+    case tag_style::upper_camel: return make_upper_camel(tag);
+    case tag_style::lower_camel: return make_lower_camel(tag);
+    case tag_style::kebab: return make_kebab_case(tag);
+    default: return tag;
+    }
+}
+
+// Tag style cache
+// ===========================
+//
+// A vault spells the same few thousand tags over and over, so
+// conversions are memoized, keyed by the spelling without its prefix.
+// A thread looks in its own front cache first, which takes no lock,
+// then in the shared cache, split into shards behind shared_mutexes
+
+struct string_hash
+{
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const
+    {
+        return std::hash<std::string_view>{}(s);
+    }
+};
+using string_map
+  = std::unordered_map<std::string, std::string, string_hash, std::equal_to<>>;
+
+const int NUM_OF_TAG_STYLES = 4;
+const size_t NUM_OF_TAG_CACHE_SHARDS = 64;
+// a full front cache starts over
+const size_t FRONT_TAG_CACHE_CAPACITY = 4096;
+
+struct tag_cache_shard
+{
+    std::shared_mutex mutex;
+    string_map maps[NUM_OF_TAG_STYLES];
+};
+
+struct tag_cache_stats
+{
+    std::atomic<uint64_t> front_hits{0};
+    std::atomic<uint64_t> shared_hits{0};
+    std::atomic<uint64_t> misses{0};
+};
+
+static tag_cache_shard TAG_CACHE[NUM_OF_TAG_CACHE_SHARDS];
+static tag_cache_stats TAG_CACHE_STATS;
+
+// front hits are counted locally, and handed over when the thread exits
+struct front_tag_cache
+{
+    string_map maps[NUM_OF_TAG_STYLES];
+    uint64_t hits = 0;
+    ~front_tag_cache() { TAG_CACHE_STATS.front_hits += hits; }
+};
+
+static thread_local front_tag_cache FRONT_TAG_CACHE;
+
+std::string convert_tag(std::string &tag, tag_style ts)
+{
+    int style = static_cast<int>(ts);
+    if(tag.empty() || style < 0 || style >= NUM_OF_TAG_STYLES)
+        return convert_tag_(tag, ts);
+    std::string_view key{tag.data() + 1, tag.size() - 1};
+
+    auto &front = FRONT_TAG_CACHE.maps[style];
+    if(auto found = front.find(key); found != front.end())
+    {
+        ++FRONT_TAG_CACHE.hits;
+        return found->second;
+    }
+
+    size_t hash = string_hash{}(key);
+    auto &shard = TAG_CACHE[hash % NUM_OF_TAG_CACHE_SHARDS];
+    std::string new_tag;
+    bool found_in_shard = false;
+    {
+        std::shared_lock lock(shard.mutex);
+        auto &map = shard.maps[style];
+        if(auto found = map.find(key); found != map.end())
+        {
+            new_tag = found->second;
+            found_in_shard = true;
+        }
+    }
+    if(found_in_shard)
+    {
+        TAG_CACHE_STATS.shared_hits.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        TAG_CACHE_STATS.misses.fetch_add(1, std::memory_order_relaxed);
+        new_tag = convert_tag_(tag, ts);
+        std::unique_lock lock(shard.mutex);
+        shard.maps[style].try_emplace(std::string{key}, new_tag);
+    }
+
+    if(front.size() >= FRONT_TAG_CACHE_CAPACITY)
+        front.clear();
+    front.try_emplace(std::string{key}, new_tag);
+    return new_tag;
+}
+
+// (front hits, shared hits, misses), front hits of other threads only
+// count once those threads exit
+std::tuple<uint64_t, uint64_t, uint64_t> tag_cache_counts()
+{
+    return {TAG_CACHE_STATS.front_hits + FRONT_TAG_CACHE.hits,
+            TAG_CACHE_STATS.shared_hits, TAG_CACHE_STATS.misses};
+}
+
 // return: changed something?
 bool tag_filter(std::string &line, std::vector<std::string> &tags,
                 tag_style ts)
@@ -250,14 +397,7 @@ bool tag_filter(std::string &line, std::vector<std::string> &tags,
         std::string new_line = "";
         for(std::string &tag : tags)
         {
-            switch(ts)
-            {
-            case tag_style::snake: tag = make_snake_case(tag); break;
-            case tag_style::upper_camel: tag = make_upper_camel(tag); break;
-            case tag_style::lower_camel: tag = make_lower_camel(tag); break;
-            case tag_style::kebab: tag = make_kebab_case(tag); break;
-            default: break;
-            }
+            tag = convert_tag(tag, ts);
             new_line.append(tag);
             new_line.append(" ");
         }
@@ -268,50 +408,374 @@ bool tag_filter(std::string &line, std::vector<std::string> &tags,
     return changed_sth;
 }
 
-std::tuple<std::string, std::string> split_yaml_tags(std::string &tag)
+bool is_tag_head(char c)
 {
-    auto i = tag.begin();
-    while(*i++ != '-')
-        ;
-    std::string prefix{tag.begin(), i};
-    auto tag_start = i;
-    while(++i != tag.end() && *i != ' ')
-        ;
-    return {prefix, std::string{tag_start, i}};
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
 }
 
-bool tag_filter_yaml(std::vector<std::string>::iterator &i,
-                     std::vector<std::string> &tags, tag_style ts)
+bool is_tag_body(char c) { return is_tag_head(c) || c == '-'; }
+
+// what may precede an inline tag, as in "see (#todo) or \"#done\""
+bool is_tag_lead(char c)
+{
+    return std::isspace(static_cast<unsigned char>(c))
+           || (c != '\0' && strchr("([{\"'", c));
+}
+
+// what may follow an inline tag, as in "see #todo, then #done."
+// a nested tag "#project/sub" counts as its parent "#project",
+// a quote only closes a tag it opened, "#don't" is no tag
+bool is_tag_tail(char c)
 {
-    while(!i->starts_with("tags:") && !i->starts_with("Tags:"))
+    return std::isspace(static_cast<unsigned char>(c))
+           || (c != '\0' && strchr(".,;:!?)]}\"'/", c));
+}
+
+// find the next run of exactly n backticks, which closes a code span
+const char *find_backtick_run(const char *first, const char *last, size_t n)
+{
+    while(first < last)
     {
-        ++i;
+        auto tick = static_cast<const char *>(memchr(first, '`', last - first));
+        if(!tick)
+            return nullptr;
+        auto i = tick;
+        while(i < last && *i == '`')
+            ++i;
+        if(static_cast<size_t>(i - tick) == n)
+            return tick;
+        first = i;
     }
-    ++i; // skip "tags:"
+    return nullptr;
+}
+
+// tick starts a run of backticks, return where the code span it opens
+// ends, an unmatched run is just literal text and ends with itself
+const char *skip_code_span(const char *tick, const char *end)
+{
+    auto run = tick;
+    while(run < end && *run == '`')
+        ++run;
+    auto close = find_backtick_run(run, end, run - tick);
+    return close ? close + (run - tick) : run;
+}
+
+// inline tags: '#tag' anywhere in prose, like "read #todo later"
+// candidates are located with memchr, which libc vectorizes,
+// so a line without '#' costs a single scan
+// 1. headings are skipped
+// 2. a '#' must start the line or follow a space or an opening
+//   bracket or quote, this rules out URL fragments and html entities
+//   like "&#39;", anchors like "[setup](#setup)" and "[[#heading]]"
+//   are links, not tags
+// 3. nothing inside `code spans` is touched
+// 4. purely numeric tags like "#1" are not tags
+// return: changed something?
+bool inline_tag_filter(std::string &line, std::vector<std::string> &tags,
+                       tag_style ts)
+{
+    const char *base = line.data();
+    const char *end = base + line.size();
+    if(!memchr(base, '#', line.size()))
+        return false;
+    if(line[0] == '#'
+       && (line.size() == 1 || line[1] == '#'
+           || std::isspace(static_cast<unsigned char>(line[1]))))
+        return false;
+
+    // (offset, length, replacement)
+    std::vector<std::tuple<size_t, size_t, std::string>> edits;
+    auto i = base;
+    auto tick = static_cast<const char *>(memchr(i, '`', end - i));
+    while(i < end)
+    {
+        auto hash = static_cast<const char *>(memchr(i, '#', end - i));
+        if(!hash)
+            break;
+        if(tick && tick < hash)
+        {
+            i = skip_code_span(tick, end);
+            tick = static_cast<const char *>(memchr(i, '`', end - i));
+            continue;
+        }
+        i = hash + 1;
+        if(hash != base && !is_tag_lead(hash[-1]))
+            continue;
+        if(hash - base >= 2
+           && ((hash[-1] == '(' && hash[-2] == ']')
+               || (hash[-1] == '[' && hash[-2] == '[')))
+            continue;
+        if(i == end || !is_tag_head(*i))
+            continue;
+        bool numeric = true;
+        while(i < end && is_tag_body(*i))
+        {
+            numeric &= std::isdigit(static_cast<unsigned char>(*i)) != 0;
+            ++i;
+        }
+        if(numeric || (i != end && !is_tag_tail(*i)))
+            continue;
+        if(i != end && (*i == '"' || *i == '\'')
+           && (hash == base || hash[-1] != *i))
+            continue;
+
+        std::string tag{hash, i};
+        std::string new_tag = convert_tag(tag, ts);
+        if(new_tag.empty())
+            continue;
+        tags.push_back(new_tag);
+        new_tag.insert(0, 1, '#');
+        if(new_tag != tag)
+        {
+            edits.emplace_back(hash - base, i - hash, std::move(new_tag));
+        }
+    }
+    // back to front, so the offsets stay valid
+    for(auto e = edits.rbegin(); e != edits.rend(); ++e)
+    {
+        auto &[offset, length, new_tag] = *e;
+        line.replace(offset, length, new_tag);
+    }
+    return !edits.empty();
+}
+
+// [[target]], [[target|alias]] and [[target#heading]] all link to target,
+// links inside `code spans` don't count
+void wiki_link_filter(std::string_view line, std::vector<std::string> &links)
+{
+    const char *base = line.data();
+    const char *end = base + line.size();
+    auto i = base;
+    auto tick = static_cast<const char *>(memchr(i, '`', end - i));
+    while(i < end)
+    {
+        auto open = static_cast<const char *>(memchr(i, '[', end - i));
+        if(!open)
+            return;
+        if(tick && tick < open)
+        {
+            i = skip_code_span(tick, end);
+            tick = static_cast<const char *>(memchr(i, '`', end - i));
+            continue;
+        }
+        i = open + 1;
+        if(i == end || *i != '[')
+            continue;
+        auto close = line.find("]]", i + 1 - base);
+        if(close == std::string_view::npos)
+            return;
+        auto target = line.substr(i + 1 - base, close - (i + 1 - base));
+        target = target.substr(0, target.find_first_of("|#"));
+        auto first = target.find_first_not_of(' ');
+        auto last = target.find_last_not_of(' ');
+        if(first != std::string_view::npos
+           && target.find('[') == std::string_view::npos)
+        {
+            links.emplace_back(target.substr(first, last - first + 1));
+        }
+        i = base + close + 2;
+        if(tick && tick < i)
+            tick = static_cast<const char *>(memchr(i, '`', end - i));
+    }
+}
+
+// YAML frontmatter
+// ===========================
+//
+// recognized forms, keys are case insensitive:
+//
+// tags:            tags: [a, "b c"]     keywords: a
+//   - a
+//   - b
+//
+// a '#' after a blank starts a comment, which is never touched
+bool is_yaml_tag_key(std::string_view key)
+{
+    auto same = [key](std::string_view name) {
+        return key.size() == name.size()
+               && std::equal(key.begin(), key.end(), name.begin(),
+                             [](char a, char b) {
+                                 return std::tolower(
+                                          static_cast<unsigned char>(a))
+                                        == b;
+                             });
+    };
+    return same("tags") || same("keywords");
+}
+
+// where the value starting at first ends: before the blanks ahead of a
+// comment, or at the line end, '#' inside quotes is not a comment
+size_t yaml_value_end(std::string_view line, size_t first)
+{
+    // one past the last non-blank seen
+    size_t value_end = first;
+    char quote = 0;
+    for(size_t i = first; i < line.size(); ++i)
+    {
+        char c = line[i];
+        if(quote)
+        {
+            if(c == quote)
+                quote = 0;
+            value_end = i + 1;
+            continue;
+        }
+        if(c == ' ' || c == '\t')
+            continue;
+        if(c == '#' && i > 0 && (line[i - 1] == ' ' || line[i - 1] == '\t'))
+            return value_end;
+        // only a quote that starts a scalar opens a quoted one
+        if((c == '"' || c == '\'')
+           && (value_end == first || line[value_end - 1] == '['
+               || line[value_end - 1] == ','))
+            quote = c;
+        value_end = i + 1;
+    }
+    return line.size();
+}
+
+// rewrite the entry line[first, last) in place, only if it changes,
+// quotes and a leading '#' are kept, trailing blanks are dropped
+bool yaml_entry_filter(std::string &line, size_t first, size_t last,
+                       std::vector<std::string> &tags, tag_style ts)
+{
+    size_t value_end = last;
+    while(value_end > first && std::isspace(static_cast<unsigned char>(
+                                 line[value_end - 1])))
+        --value_end;
+    if(value_end - first >= 2 && (line[first] == '"' || line[first] == '\'')
+       && line[value_end - 1] == line[first])
+    {
+        // the closing quote stays, so do the blanks behind it
+        ++first;
+        last = --value_end;
+    }
+    if(first < value_end && line[first] == '#')
+        ++first;
+    if(first == value_end)
+        return false;
+
+    // convert_tag expects a prefix, see split_tag
+    std::string tag(value_end - first + 1, ' ');
+    line.copy(tag.data() + 1, value_end - first, first);
+    std::string new_tag = convert_tag(tag, ts);
+    if(new_tag.empty())
+        return false;
+    bool changed_sth = line.compare(first, last - first, new_tag) != 0;
+    if(changed_sth)
+    {
+        line.replace(first, last - first, new_tag);
+    }
+    tags.push_back(std::move(new_tag));
+    return changed_sth;
+}
+
+// tags: [a, "b, c", d]
+// a flow list must fit in line[first, last), a missing ']' ends it at last
+bool yaml_flow_filter(std::string &line, size_t first, size_t last,
+                      std::vector<std::string> &tags, tag_style ts)
+{
+    std::vector<std::pair<size_t, size_t>> entries;
+    size_t head = first;
+    char quote = 0;
+    for(size_t i = first; i <= last; ++i)
+    {
+        char c = i < last ? line[i] : ']';
+        if(quote)
+        {
+            if(c == quote)
+                quote = 0;
+            continue;
+        }
+        if(c == '"' || c == '\'')
+        {
+            quote = c;
+        }
+        else if(c == ',' || c == ']')
+        {
+            auto l = line.find_first_not_of(' ', head);
+            auto r = line.find_last_not_of(' ', i - 1);
+            if(l < i && r != std::string::npos && r >= l)
+            {
+                entries.emplace_back(l, r + 1);
+            }
+            head = i + 1;
+            if(c == ']')
+                break;
+        }
+    }
+
+    // back to front, so the offsets stay valid
+    bool changed_sth = false;
+    auto n = tags.size();
+    for(auto e = entries.rbegin(); e != entries.rend(); ++e)
+    {
+        changed_sth |= yaml_entry_filter(line, e->first, e->second, tags, ts);
+    }
+    std::reverse(tags.begin() + n, tags.end());
+    return changed_sth;
+}
+
+// i points to the line after the opening '---', the scan stops at the
+// closing '---' or '...', and never goes beyond last
+bool tag_filter_yaml(std::vector<std::string>::iterator &i,
+                     std::vector<std::string>::iterator last,
+                     std::vector<std::string> &tags, tag_style ts)
+{
     bool changed_sth = false;
-    // in tag region
-    while(i->starts_with("  "))
+    bool in_tag_list = false;
+    for(; i != last; ++i)
     {
-        auto [line, tag] = split_yaml_tags(*i);
-        switch(ts)
+        std::string_view line = *i;
+        if(line.starts_with("---") || line.starts_with("..."))
+            break;
+        auto indent = line.find_first_not_of(' ');
+        if(indent == std::string_view::npos || line[indent] == '#')
+            continue;
+        if(in_tag_list && line[indent] == '-'
+           && (indent + 1 == line.size() || line[indent + 1] == ' '))
         {
-        case tag_style::snake: tag = make_snake_case(tag); break;
-        case tag_style::upper_camel: tag = make_upper_camel(tag); break;
-        case tag_style::lower_camel: tag = make_lower_camel(tag); break;
-        case tag_style::kebab: tag = make_kebab_case(tag); break;
-        default: break;
+            auto first = line.find_first_not_of(' ', indent + 1);
+            if(first != std::string_view::npos)
+            {
+                changed_sth |= yaml_entry_filter(
+                  *i, first, yaml_value_end(line, first), tags, ts);
+            }
+            continue;
+        }
+        in_tag_list = false;
+        // nested mappings are not ours
+        if(indent != 0)
+            continue;
+        auto colon = line.find(':');
+        if(colon == std::string_view::npos
+           || !is_yaml_tag_key(line.substr(0, colon)))
+            continue;
+        auto first = line.find_first_not_of(' ', colon + 1);
+        auto last = first == std::string_view::npos
+                      ? first
+                      : yaml_value_end(line, first);
+        if(first == last)
+        {
+            // nothing but maybe a comment, a block list follows
+            in_tag_list = true;
+        }
+        else if(line[first] == '[')
+        {
+            changed_sth |= yaml_flow_filter(*i, first + 1, last, tags, ts);
+        }
+        else
+        {
+            changed_sth |= yaml_entry_filter(*i, first, last, tags, ts);
         }
-        line.append(" ");
-        line.append(tag);
-        changed_sth |= (line != *i);
-        *i = line;
-        tags.push_back(tag);
-        ++i;
     }
     return changed_sth;
 }
 
-pair_loaded_text_tags parse_text(std::shared_ptr<loaded_text> mt, tag_style ts)
+// links: if not null, collect the targets of wiki-links as well
+pair_loaded_text_tags parse_text(std::shared_ptr<loaded_text> mt, tag_style ts,
+                                 bool inline_tags = false,
+                                 std::vector<std::string> *links = nullptr)
 {
     std::string line;
     std::vector<std::string> tags;
@@ -325,26 +789,30 @@ pair_loaded_text_tags parse_text(std::shared_ptr<loaded_text> mt, tag_style ts)
         {
             in_code_block = !in_code_block;
         }
-        else if(i->starts_with("---") && !in_code_block)
+        else if(i == mt->lines.begin() && i->starts_with("---"))
         {
-            ++i;
-            std::vector<std::string> sub_tags;
-            changed_sth |= tag_filter_yaml(i, sub_tags, ts);
-            if(!sub_tags.empty())
-            {
-                tags.insert(tags.end(), sub_tags.begin(), sub_tags.end());
-            }
-            while(!i->starts_with("---"))
-                ++i;
+            // frontmatter only opens on the first line, a later '---'
+            // is a thematic break
+            changed_sth |= tag_filter_yaml(++i, mt->lines.end(), tags, ts);
+            if(i == mt->lines.end())
+                break;
         }
         else if(!in_code_block)
         {
             std::vector<std::string> sub_tags;
             changed_sth |= tag_filter(*i, sub_tags, ts);
+            if(inline_tags && sub_tags.empty())
+            {
+                changed_sth |= inline_tag_filter(*i, sub_tags, ts);
+            }
             if(!sub_tags.empty())
             {
                 tags.insert(tags.end(), sub_tags.begin(), sub_tags.end());
             }
+            if(links)
+            {
+                wiki_link_filter(*i, *links);
+            }
         }
     }
     mt->modified = changed_sth;
@@ -0,0 +1,208 @@
+#pragma once
+// Tracing
+// ===========================
+//
+// `--trace out.json` records what every thread does and when, in the
+// Chrome trace-event format, open it with https://ui.perfetto.dev
+//
+// Each thread writes into its own ring buffer and nobody else touches
+// it until every thread is joined, so recording takes no lock.
+// Only a thread's first event takes the registry lock.
+// A ring grows a chunk at a time, a full one overwrites its oldest events.
+
+#include <morg/types.h>
+
+namespace morg
+{
+const size_t TRACE_RING_CAPACITY = 1 << 16;
+const size_t TRACE_CHUNK_CAPACITY = 1 << 10;
+const uint32_t TRACE_NO_FILE = UINT32_MAX;
+
+struct trace_event
+{
+    // a string literal
+    const char *name;
+    // 'X' for a span, 'C' for a counter
+    char phase;
+    int64_t ts_us;
+    // the duration of a span, or the value of a counter
+    int64_t value;
+    uint32_t file;
+};
+
+struct trace_ring
+{
+    int tid;
+    std::string thread_name;
+    // left uninitialized, a thread only pays for the events it records
+    std::vector<std::unique_ptr<trace_event[]>> chunks;
+    // number of events ever recorded
+    size_t head;
+    explicit trace_ring(int tid) : tid(tid), head(0) {}
+    void push(const trace_event &e)
+    {
+        size_t slot = head % TRACE_RING_CAPACITY;
+        if(slot / TRACE_CHUNK_CAPACITY == chunks.size())
+        {
+            chunks.emplace_back(new trace_event[TRACE_CHUNK_CAPACITY]);
+        }
+        at(slot) = e;
+        ++head;
+    }
+    trace_event &at(size_t slot)
+    {
+        return chunks[slot / TRACE_CHUNK_CAPACITY][slot % TRACE_CHUNK_CAPACITY];
+    }
+};
+
+// set before any thread starts, read only after
+static bool TRACE_ENABLED = false;
+static std::chrono::steady_clock::time_point TRACE_EPOCH;
+static std::mutex TRACE_REGISTRY_MUTEX;
+static std::vector<std::unique_ptr<trace_ring>> TRACE_REGISTRY;
+// bumped by every trace_start, a ring of an older one is gone
+static uint32_t TRACE_GENERATION = 0;
+static thread_local trace_ring *TRACE_RING = nullptr;
+static thread_local uint32_t TRACE_RING_GENERATION = 0;
+
+int64_t trace_now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - TRACE_EPOCH)
+      .count();
+}
+
+trace_ring &trace_this_thread()
+{
+    if(!TRACE_RING || TRACE_RING_GENERATION != TRACE_GENERATION)
+    {
+        std::lock_guard lock(TRACE_REGISTRY_MUTEX);
+        int tid = TRACE_REGISTRY.size() + 1;
+        TRACE_REGISTRY.push_back(std::make_unique<trace_ring>(tid));
+        TRACE_RING = TRACE_REGISTRY.back().get();
+        TRACE_RING_GENERATION = TRACE_GENERATION;
+    }
+    return *TRACE_RING;
+}
+
+// drops the rings of an earlier trace
+void trace_start()
+{
+    TRACE_REGISTRY.clear();
+    ++TRACE_GENERATION;
+    TRACE_RING = nullptr;
+    TRACE_ENABLED = true;
+    TRACE_EPOCH = std::chrono::steady_clock::now();
+}
+
+void trace_thread_name(std::string name)
+{
+    if(TRACE_ENABLED)
+        trace_this_thread().thread_name = std::move(name);
+}
+
+void trace_counter(const char *name, int64_t value)
+{
+    if(TRACE_ENABLED)
+    {
+        trace_this_thread().push(
+          {name, 'C', trace_now(), value, TRACE_NO_FILE});
+    }
+}
+
+// records the lifetime of the object as a span
+struct trace_span
+{
+    const char *name;
+    uint32_t file;
+    int64_t start;
+    trace_span(const char *name, uint32_t file = TRACE_NO_FILE)
+        : name(name), file(file), start(TRACE_ENABLED ? trace_now() : 0)
+    {}
+    ~trace_span()
+    {
+        if(TRACE_ENABLED)
+        {
+            trace_this_thread().push(
+              {name, 'X', start, trace_now() - start, file});
+        }
+    }
+    trace_span(const trace_span &) = delete;
+    trace_span &operator=(const trace_span &) = delete;
+};
+
+std::string json_escape(std::string_view s)
+{
+    std::string escaped;
+    for(char c : s)
+    {
+        if(c == '"' || c == '\\')
+        {
+            escaped.push_back('\\');
+            escaped.push_back(c);
+        }
+        else if(static_cast<unsigned char>(c) < 0x20)
+        {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            escaped.append(buf);
+        }
+        else
+        {
+            escaped.push_back(c);
+        }
+    }
+    return escaped;
+}
+
+// only once every traced thread is joined, this also ends tracing,
+// file indexes are resolved to file names through files
+void trace_write(const std::filesystem::path &path, const file_table &files)
+{
+    TRACE_ENABLED = false;
+    std::ofstream out(path, std::ios::out);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto next = [&]() -> std::ofstream & {
+        if(!first)
+            out << ",";
+        first = false;
+        out << "\n";
+        return out;
+    };
+    for(auto &ring : TRACE_REGISTRY)
+    {
+        if(!ring->thread_name.empty())
+        {
+            next() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                   << "\"tid\":" << ring->tid << ",\"args\":{\"name\":\""
+                   << json_escape(ring->thread_name) << "\"}}";
+        }
+        size_t oldest = ring->head > TRACE_RING_CAPACITY
+                          ? ring->head - TRACE_RING_CAPACITY
+                          : 0;
+        for(size_t i = oldest; i < ring->head; ++i)
+        {
+            auto &e = ring->at(i % TRACE_RING_CAPACITY);
+            auto &o = next();
+            o << "{\"name\":\"" << e.name << "\",\"ph\":\"" << e.phase
+              << "\",\"pid\":1,\"tid\":" << ring->tid << ",\"ts\":" << e.ts_us;
+            if(e.phase == 'C')
+            {
+                o << ",\"args\":{\"value\":" << e.value << "}}";
+                continue;
+            }
+            o << ",\"dur\":" << e.value;
+            if(e.file < files.size() && files.texts[e.file])
+            {
+                o << ",\"args\":{\"file\":\""
+                  << json_escape(files.texts[e.file]->path.filename().string())
+                  << "\"}";
+            }
+            o << "}";
+        }
+    }
+    out << "\n]}" << std::endl;
+}
+
+}
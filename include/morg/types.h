@@ -1,22 +1,32 @@
 #pragma once
 #include <algorithm>
+#include <atomic>
 #include <locale>
 #include <chrono>
+#include <cstdint>
+#include <climits>
+#include <cmath>
+#include <cstring>
 #include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <random>
 #include <regex>
 #include <set>
+#include <shared_mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <tuple>
+#include <unordered_map>
+#include <type_traits>
 #include <utility>
-#include <variant>
 #include <memory>
+#include <mutex>
 // Use Lockless Queue
 // [moodycamel::ConcurrentQueue](https://github.com/cameron314/concurrentqueue)
 #include <concurrentqueue.h>
@@ -54,10 +64,6 @@ using pair_tag_loaded_texts
   = std::pair<std::string, std::vector<std::shared_ptr<loaded_text>>>;
 using pair_loaded_text_tags
   = std::pair<std::shared_ptr<loaded_text>, std::vector<std::string>>;
-using task_value
-  = std::variant<int, std::string, pair_path_tags, pair_tag_paths,
-                 std::filesystem::path, std::shared_ptr<loaded_text>,
-                 pair_loaded_text_tags>;
 
 enum class task_type
 {
@@ -83,40 +89,76 @@ enum class tag_style
     upper_camel,
     lower_camel
 };
+// Tasks carry no payload, only an index into the file_table,
+// so every queue slot is 8 bytes and trivially copyable
 struct task_t
 {
     task_type type;
-    task_value value;
+    // index of the file, or the number of files for all_files_are_sent
+    uint32_t value;
 };
+static_assert(std::is_trivially_copyable_v<task_t>);
 using queue = moodycamel::ConcurrentQueue<task_t>;
 
+// Structure of arrays, one slot per file, indexed by task_t::value.
+// The TaskSpawner sizes it before the first task is sent, after that
+// slot i is only touched by whoever holds the task of file i,
+// the queues order the hand-over, so no locking is needed
+struct file_table
+{
+    std::vector<std::shared_ptr<loaded_text>> texts;
+    std::vector<std::vector<std::string>> tags;
+    // targets of the [[wiki-links]] in each file, only with --backlinks
+    std::vector<std::vector<std::string>> links;
+
+    void resize(size_t n)
+    {
+        texts.resize(n);
+        tags.resize(n);
+        links.resize(n);
+    }
+    size_t size() const { return texts.size(); }
+};
+
 struct context
 {
     std::filesystem::path root_dir;
     std::filesystem::path particular_file;
     std::filesystem::path output_dir;
+    // write a Chrome trace of the run here, empty for none
+    std::filesystem::path trace_file;
     tag_style ts;
     int num_of_workers;
-    context() : num_of_workers(1) {}
+    // look for tags inside prose, not only on tag lines
+    bool inline_tags;
+    // collect [[wiki-links]] and write __backlinks.md
+    bool backlinks;
+    // list this many related tags in each roadmap, 0 for none
+    int related_tags;
+    context()
+        : ts(tag_style::snake), num_of_workers(1), inline_tags(false),
+          backlinks(false), related_tags(0)
+    {}
     context(const context &ctx)
         : root_dir(ctx.root_dir), particular_file(ctx.particular_file),
-          output_dir(ctx.output_dir), num_of_workers(ctx.num_of_workers),
-          ts(tag_style::snake)
+          output_dir(ctx.output_dir), trace_file(ctx.trace_file), ts(ctx.ts),
+          num_of_workers(ctx.num_of_workers), inline_tags(ctx.inline_tags),
+          backlinks(ctx.backlinks), related_tags(ctx.related_tags)
     {}
 };
 
 struct manager_t
 {
-    std::vector<std::shared_ptr<loaded_text>> texts;
     map_tag_loaded_texts dict;
     // send things to workers
     queue *to_worker;
     queue *to_manager;
+    file_table *files;
     // std::string_view root_dir;
     // int num_workers;
     context ctx;
-    manager_t(queue *w, queue *_2m, context &ctx)
-        : to_worker(w), to_manager(_2m), ctx(ctx)
+    manager_t(queue *w, queue *_2m, file_table *files, context &ctx)
+        : to_worker(w), to_manager(_2m), files(files), ctx(ctx)
     {}
     manager_t() = delete;
 };
@@ -128,10 +170,11 @@ struct worker
     queue *to_worker;
     // for feedback or whatever submission
     queue *to_manager;
+    file_table *files;
     context ctx;
     // std::string_view root_dir;
-    worker(int id, queue *w, queue *_2m, context &ctx)
-        : id(id), to_worker(w), to_manager(_2m), ctx(ctx)
+    worker(int id, queue *w, queue *_2m, file_table *files, context &ctx)
+        : id(id), to_worker(w), to_manager(_2m), files(files), ctx(ctx)
     {}
     worker() = delete;
 };
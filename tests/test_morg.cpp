@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 #include <morg/morg.h>
+#include <morg/gen.h>
+#include <optional>
+#include <random>
 using namespace morg;
 
 TEST(CPP, testCopy)
@@ -13,16 +16,21 @@ TEST(CPP, testCopy)
 
 TEST(test, testParseContext)
 {
+    auto root = std::filesystem::temp_directory_path() / "Zettelkasten";
+    auto out = std::filesystem::temp_directory_path() / "morg_out";
+    std::filesystem::create_directories(root);
     const char *argv[]
-      = {"morg",          "-d",          "/tmp/Zettelkasten", "-j", "99", "-O",
-         "/tmp/morg_out", "--tag-style", "snake_case"};
+      = {"morg",      "-d",          root.c_str(), "-j", "99", "-O",
+         out.c_str(), "--tag-style", "snake_case"};
     int argc = sizeof(argv) / sizeof(char *);
     context ctx = parse_context(argc, argv);
-    ASSERT_EQ(ctx.root_dir, "/tmp/Zettelkasten");
+    ASSERT_EQ(ctx.root_dir, root);
     ASSERT_EQ(ctx.particular_file, "");
-    ASSERT_EQ(ctx.output_dir, "/tmp/morg_out");
+    ASSERT_EQ(ctx.output_dir, out);
     ASSERT_EQ(ctx.num_of_workers, 99);
     ASSERT_EQ(ctx.ts, tag_style::snake);
+    std::filesystem::remove_all(root);
+    std::filesystem::remove_all(out);
 }
 
 TEST(test, testSplitTag)
@@ -116,4 +124,454 @@ TEST(test, testYamlHeader)
     ASSERT_EQ(t->lines[4], "    - hello_fucking_world");
     ASSERT_EQ(t->lines[5], "    - hello_fucking_world");
     ASSERT_EQ(t->lines[6], "    - hello_fucking_world");
-}
\ No newline at end of file
+}
+TEST(test, testInlineTags)
+{
+    auto ts = tag_style::snake;
+    {
+        std::string line = "read #helloWorld later, then #TODO.";
+        std::vector<std::string> tags;
+        ASSERT_TRUE(inline_tag_filter(line, tags, ts));
+        ASSERT_EQ(line, "read #hello_world later, then #todo.");
+        ASSERT_EQ(tags.size(), 2);
+        ASSERT_EQ(tags[0], "hello_world");
+        ASSERT_EQ(tags[1], "todo");
+    }
+    {
+        // code spans, URLs, anchors, entities, issue numbers and words with
+        // an apostrophe are not tags
+        std::string line = "`#helloWorld` http://a.io/#fooBar &#39; #1 ``#a`b`` "
+                           "[setup](#gettingStarted) [[#myHeading]] I #don't know";
+        std::string old = line;
+        std::vector<std::string> tags;
+        ASSERT_FALSE(inline_tag_filter(line, tags, ts));
+        ASSERT_EQ(line, old);
+        ASSERT_TRUE(tags.empty());
+    }
+    {
+        // brackets and quotes around a tag, nested tags count as the parent
+        std::string line = "(#fooBar) \"#bazQux\" [#a_b] #project/subTask";
+        std::vector<std::string> tags;
+        ASSERT_TRUE(inline_tag_filter(line, tags, ts));
+        ASSERT_EQ(line, "(#foo_bar) \"#baz_qux\" [#a_b] #project/subTask");
+        std::vector<std::string> expected{"foo_bar", "baz_qux", "a_b",
+                                          "project"};
+        ASSERT_EQ(tags, expected);
+    }
+    {
+        std::string line = "## Hello #helloWorld";
+        std::vector<std::string> tags;
+        ASSERT_FALSE(inline_tag_filter(line, tags, ts));
+        ASSERT_TRUE(tags.empty());
+    }
+    {
+        // an unmatched backtick is literal text
+        std::string line = "a ` b #hello_world";
+        std::vector<std::string> tags;
+        ASSERT_FALSE(inline_tag_filter(line, tags, ts));
+        ASSERT_EQ(tags.size(), 1);
+    }
+    {
+        std::vector<std::string> md{
+          "#tagLine",
+          "some #inlineTag here",
+          "```",
+          "#not_a_tag in code",
+          "```",
+        };
+        auto mt = loaded_text::create();
+        mt->lines = std::move(md);
+        auto [t, tags] = parse_text(mt, ts, true);
+        ASSERT_EQ(tags.size(), 2);
+        ASSERT_EQ(t->lines[1], "some #inline_tag here");
+        ASSERT_EQ(t->lines[3], "#not_a_tag in code");
+    }
+}
+
+TEST(test, testYamlForms)
+{
+    std::vector<std::string> md{
+      "---",                                 // 0
+      "Tags: [HelloWorld, \"fooBar\", baz]", // 1
+      "keywords: TCP",                       // 2
+      "aliases:",                            // 3
+      "  - NotATag",                         // 4
+      "tags:",                               // 5
+      "- alreadySnake",                      // 6
+      "- already_snake",                     // 7
+      "title: x",                            // 8
+      "  - NotATag",                         // 9
+      "---",                                 // 10
+      "---",                                 // 11
+      "  - NotATag",                         // 12
+    };
+    auto mt = loaded_text::create();
+    mt->lines = std::move(md);
+    auto [t, tags] = parse_text(mt, tag_style::snake);
+    ASSERT_EQ(t->modified, true);
+    std::vector<std::string> expected{"hello_world",   "foo_bar",
+                                      "baz",           "tcp",
+                                      "already_snake", "already_snake"};
+    ASSERT_EQ(tags, expected);
+    ASSERT_EQ(t->lines[1], "Tags: [hello_world, \"foo_bar\", baz]");
+    ASSERT_EQ(t->lines[2], "keywords: tcp");
+    ASSERT_EQ(t->lines[4], "  - NotATag");
+    ASSERT_EQ(t->lines[6], "- already_snake");
+    ASSERT_EQ(t->lines[9], "  - NotATag");
+    ASSERT_EQ(t->lines[12], "  - NotATag");
+
+    // comments
+    mt = loaded_text::create();
+    mt->lines = {
+      "---",                                 // 0
+      "tags: # below",                       // 1
+      "  - fooBar # a comment",              // 2
+      "  - #bazQux",                         // 3
+      "  - \"#hashTag\"  # c",               // 4
+      "keywords: [helloWorld, #x]",          // 5
+      "Tags: TCP#ip  #notATag",              // 6
+      "---",                                 // 7
+    };
+    std::tie(t, tags) = parse_text(mt, tag_style::snake);
+    expected = {"foo_bar", "hash_tag", "hello_world", "tcp_ip"};
+    ASSERT_EQ(tags, expected);
+    ASSERT_EQ(t->lines[1], "tags: # below");
+    ASSERT_EQ(t->lines[2], "  - foo_bar # a comment");
+    ASSERT_EQ(t->lines[3], "  - #bazQux");
+    ASSERT_EQ(t->lines[4], "  - \"#hash_tag\"  # c");
+    ASSERT_EQ(t->lines[5], "keywords: [hello_world, #x]");
+    ASSERT_EQ(t->lines[6], "Tags: tcp_ip  #notATag");
+
+    // a quoted entry may hold a comma
+    std::string line = "tags: [a, \"b, c\", d]";
+    tags.clear();
+    ASSERT_TRUE(yaml_flow_filter(line, 7, line.size(), tags, tag_style::snake));
+    expected = {"a", "b_c", "d"};
+    ASSERT_EQ(tags, expected);
+    ASSERT_EQ(line, "tags: [a, \"b_c\", d]");
+}
+
+TEST(test, testYamlUnterminated)
+{
+    {
+        auto mt = loaded_text::create();
+        mt->lines = {"---", "tags:", "  - helloWorld"};
+        auto [t, tags] = parse_text(mt, tag_style::snake);
+        ASSERT_EQ(tags.size(), 1);
+        ASSERT_EQ(t->lines[2], "  - hello_world");
+    }
+    {
+        auto mt = loaded_text::create();
+        mt->lines = {"---", "title: no tags", "---", "body"};
+        auto [t, tags] = parse_text(mt, tag_style::snake);
+        ASSERT_TRUE(tags.empty());
+        ASSERT_EQ(t->modified, false);
+    }
+    {
+        auto mt = loaded_text::create();
+        mt->lines = {"---"};
+        auto [t, tags] = parse_text(mt, tag_style::snake);
+        ASSERT_TRUE(tags.empty());
+    }
+}
+
+// random frontmatter must neither crash nor touch the body, and with a
+// delimited tag style a second pass must find nothing left to rewrite,
+// camel case is lossy: "a_b" -> "AB" -> "Ab"
+TEST(test, testYamlFuzz)
+{
+    std::mt19937 rng(20221019);
+    const std::vector<std::string> pieces{
+      "---", "...", "tags:", "Tags: ", "keywords:", "tags: [", "tags: []",
+      "title: x", "  - ", "- ", "-", "  -", "[", "]", ",", "\"", "'", "#",
+      " ", "helloWorld", "TCP", "a_b", "x-y", ":", "`", "ßü"};
+    const tag_style styles[]{tag_style::snake, tag_style::kebab,
+                             tag_style::upper_camel, tag_style::lower_camel};
+    for(int round = 0; round < 5000; ++round)
+    {
+        std::vector<std::string> md{"---"};
+        int n = rng() % 12;
+        for(int l = 0; l < n; ++l)
+        {
+            std::string line;
+            int m = rng() % 6;
+            for(int k = 0; k < m; ++k)
+            {
+                line += pieces[rng() % pieces.size()];
+            }
+            md.push_back(line);
+        }
+        if(rng() % 2)
+        {
+            md.push_back("---");
+            md.push_back("plain body");
+        }
+        auto ts = styles[rng() % 4];
+        auto mt = loaded_text::create();
+        mt->lines = md;
+        parse_text(mt, ts);
+        ASSERT_EQ(mt->lines.size(), md.size());
+        if(md.back() == "plain body")
+        {
+            ASSERT_EQ(mt->lines.back(), "plain body");
+        }
+        if(ts == tag_style::snake || ts == tag_style::kebab)
+        {
+            auto once = mt->lines;
+            parse_text(mt, ts);
+            ASSERT_EQ(mt->modified, false);
+            ASSERT_EQ(mt->lines, once);
+        }
+    }
+}
+
+// hash every file in dir, in name order
+size_t hash_dir(const std::filesystem::path &dir)
+{
+    std::vector<std::filesystem::path> files;
+    for(auto &entry : std::filesystem::directory_iterator(dir))
+    {
+        files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+    std::string all;
+    for(auto &f : files)
+    {
+        std::ifstream in(f);
+        all += f.filename().string();
+        all += std::string{std::istreambuf_iterator<char>(in), {}};
+    }
+    return std::hash<std::string>{}(all);
+}
+
+// roadmaps must be byte-identical whatever -j is
+TEST(test, testDeterministicRoadmaps)
+{
+    auto root = std::filesystem::temp_directory_path() / "morg_stress";
+    std::mt19937 rng(29);
+    std::vector<std::pair<std::string, std::string>> notes;
+    for(int i = 0; i < 300; ++i)
+    {
+        std::string text = "---\ntags: [";
+        for(int t = rng() % 4; t >= 0; --t)
+        {
+            text += "tagNumber" + std::to_string(rng() % 20) + ", ";
+        }
+        text += "every]\n---\n# note\n#tag" + std::to_string(rng() % 7) + "\n";
+        notes.emplace_back("note" + std::to_string(i) + ".md", text);
+    }
+
+    std::optional<size_t> expected;
+    for(int jobs : {1, 2, 3, 8, 16, 1, 8})
+    {
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root / "out");
+        for(auto &[name, text] : notes)
+        {
+            std::ofstream(root / name) << text;
+        }
+        context ctx;
+        ctx.root_dir = root;
+        ctx.output_dir = root / "out";
+        ctx.num_of_workers = jobs;
+        ctx.related_tags = 3;
+        run(ctx);
+        size_t h = hash_dir(root / "out");
+        if(!expected)
+            expected = h;
+        ASSERT_EQ(h, *expected) << "with -j " << jobs;
+    }
+    std::filesystem::remove_all(root);
+}
+
+TEST(test, testBacklinks)
+{
+    {
+        std::vector<std::string> links;
+        wiki_link_filter("see [[a]], [[b|B]] and [[c.md#Intro]], not `[[d]]` "
+                         "nor [x] [[]] [[e",
+                         links);
+        std::vector<std::string> expected{"a", "b", "c.md"};
+        ASSERT_EQ(links, expected);
+    }
+    {
+        auto mt = loaded_text::create();
+        mt->lines = {"[[a]]", "```", "[[b]]", "```", "[[c]]"};
+        std::vector<std::string> links;
+        parse_text(mt, tag_style::snake, false, &links);
+        std::vector<std::string> expected{"a", "c"};
+        ASSERT_EQ(links, expected);
+    }
+
+    auto root = std::filesystem::temp_directory_path() / "morg_backlinks";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root / "out");
+    std::ofstream(root / "a.md") << "links to [[b]] and [[c.md]]\n";
+    std::ofstream(root / "b.md") << "back to [[a|A]], [[b]] and [[nowhere]]\n";
+    std::ofstream(root / "c.md") << "```\n[[a]]\n```\n";
+    context ctx;
+    ctx.root_dir = root;
+    ctx.output_dir = root / "out";
+    ctx.num_of_workers = 2;
+    ctx.backlinks = true;
+    run(ctx);
+    std::ifstream in(root / "out" / "__backlinks.md");
+    std::string index{std::istreambuf_iterator<char>(in), {}};
+    ASSERT_EQ(index, "# backlinks\n"
+                     "\n## [[a.md]]\n\n- [[b.md]]\n"
+                     "\n## [[b.md]]\n\n- [[a.md]]\n"
+                     "\n## [[c.md]]\n\n- [[a.md]]\n");
+    std::filesystem::remove_all(root);
+}
+
+TEST(test, testRelatedTags)
+{
+    file_table files;
+    map_tag_loaded_texts dict;
+    std::vector<std::vector<std::string>> tags{
+      {"a", "b", "c"}, {"a", "b"}, {"a", "b", "b"}, {"c", "d"}, {"e"}};
+    files.resize(tags.size());
+    for(size_t i = 0; i < tags.size(); ++i)
+    {
+        files.texts[i] = loaded_text::create();
+        files.tags[i] = tags[i];
+        for(auto &tag : tags[i])
+        {
+            dict[tag].push_back(files.texts[i]);
+        }
+    }
+    // ids follow dict: a b c d e
+    for(int jobs : {1, 3})
+    {
+        auto related = related_tags(dict, files, 2, jobs);
+        ASSERT_EQ(related.size(), 5);
+        using r = std::vector<std::pair<uint32_t, uint32_t>>;
+        ASSERT_EQ(related[0], (r{{1, 3}, {2, 1}}));
+        ASSERT_EQ(related[1], (r{{0, 3}, {2, 1}}));
+        ASSERT_EQ(related[2], (r{{0, 1}, {1, 1}}));
+        ASSERT_EQ(related[3], (r{{2, 1}}));
+        ASSERT_TRUE(related[4].empty());
+    }
+}
+
+// cached conversions must match fresh ones, from any thread, and '#'
+// and ' ' spellings share entries
+TEST(test, testTagCache)
+{
+    const tag_style styles[]{tag_style::snake, tag_style::kebab,
+                             tag_style::upper_camel, tag_style::lower_camel};
+    std::vector<std::string> spellings;
+    for(int i = 0; i < 5000; ++i)
+    {
+        spellings.push_back((i % 2 ? "#" : " ") + std::string("cacheTag")
+                            + std::to_string(i % 300) + "_X");
+    }
+    std::atomic<int> mismatches{0};
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 8; ++t)
+    {
+        threads.emplace_back([&, t] {
+            for(size_t i = 0; i < spellings.size(); ++i)
+            {
+                auto &tag = spellings[(i * 7 + t) % spellings.size()];
+                auto ts = styles[(i + t) % 4];
+                if(convert_tag(tag, ts) != convert_tag_(tag, ts))
+                    ++mismatches;
+            }
+        });
+    }
+    for(auto &t : threads)
+    {
+        t.join();
+    }
+    ASSERT_EQ(mismatches, 0);
+    auto [front_hits, shared_hits, misses] = tag_cache_counts();
+    ASSERT_GT(front_hits + shared_hits, misses);
+}
+
+TEST(test, testTrace)
+{
+    auto root = std::filesystem::temp_directory_path() / "morg_trace";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root / "out");
+    for(int i = 0; i < 10; ++i)
+    {
+        std::ofstream(root / ("note" + std::to_string(i) + ".md"))
+          << "#someTag\n";
+    }
+    context ctx;
+    ctx.root_dir = root;
+    ctx.output_dir = root / "out";
+    ctx.num_of_workers = 3;
+    ctx.trace_file = root / "trace.json";
+    auto traced_run = [&]() {
+        run(ctx);
+        std::ifstream in(ctx.trace_file);
+        return std::string{std::istreambuf_iterator<char>(in), {}};
+    };
+    auto count = [](const std::string &s, std::string_view what) {
+        size_t n = 0;
+        for(auto at = s.find(what); at != s.npos; at = s.find(what, at + 1))
+            ++n;
+        return n;
+    };
+    // a second run must not bring back the threads of the first
+    auto first_trace = traced_run();
+    std::string trace = traced_run();
+    ASSERT_FALSE(TRACE_ENABLED);
+    ASSERT_EQ(count(trace, "\"thread_name\""),
+              count(first_trace, "\"thread_name\""));
+    ASSERT_TRUE(trace.starts_with("{\"displayTimeUnit\":\"ms\","));
+    ASSERT_TRUE(trace.ends_with("]}\n"));
+    for(auto name : {"\"Relay\"", "\"TaskSpawner\"", "\"Worker 3\"",
+                     "\"load\"", "\"parse_text\"", "\"collect\"",
+                     "\"create_roadmap\"", "\"over_write\"", "\"to_worker\"",
+                     "\"note7.md\""})
+    {
+        ASSERT_NE(first_trace.find(name), std::string::npos) << name;
+    }
+    std::filesystem::remove_all(root);
+
+    // rings grow as needed and wrap around once full
+    trace_ring ring(1);
+    ASSERT_TRUE(ring.chunks.empty());
+    for(size_t i = 0; i <= TRACE_RING_CAPACITY; ++i)
+    {
+        ring.push({"x", 'C', 0, static_cast<int64_t>(i), TRACE_NO_FILE});
+        if(i == 0)
+        {
+            ASSERT_EQ(ring.chunks.size(), 1);
+        }
+    }
+    ASSERT_EQ(ring.chunks.size(), TRACE_RING_CAPACITY / TRACE_CHUNK_CAPACITY);
+    ASSERT_EQ(ring.at(0).value, TRACE_RING_CAPACITY);
+    ASSERT_EQ(ring.at(1).value, 1);
+}
+
+// the same spec gives the same vault, and morg can digest it
+TEST(test, testVaultGen)
+{
+    auto root = std::filesystem::temp_directory_path() / "morg_gen";
+    vault_spec spec;
+    spec.num_of_files = 200;
+    spec.code_block_ratio = 0.5;
+    std::vector<size_t> hashes;
+    for(uint64_t seed : {7, 7, 8})
+    {
+        spec.seed = seed;
+        std::filesystem::remove_all(root);
+        generate_vault(spec, root);
+        hashes.push_back(hash_dir(root));
+    }
+    ASSERT_EQ(hashes[0], hashes[1]);
+    ASSERT_NE(hashes[0], hashes[2]);
+
+    std::filesystem::create_directories(root / "out");
+    context ctx;
+    ctx.root_dir = root;
+    ctx.output_dir = root / "out";
+    ctx.num_of_workers = 4;
+    run(ctx);
+    ASSERT_FALSE(std::filesystem::is_empty(root / "out"));
+    std::filesystem::remove_all(root);
+}